@@ -23,8 +23,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <errno.h>
 
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
 
 const char* nodm_basename (const char* str)
 {
@@ -87,6 +93,11 @@ int child_has_quit(pid_t pid, int* quit, int* status)
     return E_SUCCESS;
 }
 
+int nodm_pidfd_open(pid_t pid)
+{
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+
 int child_must_exit(pid_t pid, const char* procdesc)
 {
     int res = E_SUCCESS;
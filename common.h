@@ -81,6 +81,16 @@ const char* nodm_strerror(int code);
  */
 int child_has_quit(pid_t pid, int* quit, int* status);
 
+/**
+ * Open a pidfd for \a pid, that becomes readable when the process exits.
+ *
+ * The file descriptor is created close-on-exec.
+ *
+ * @return
+ *   The file descriptor, or -1 on error with errno set
+ */
+int nodm_pidfd_open(pid_t pid);
+
 /**
  * Kill a child process if it still running and wait for it to end
  *
@@ -23,9 +23,13 @@
 #include "log.h"
 #include <wordexp.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <errno.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -38,24 +42,458 @@ void nodm_display_manager_init(struct nodm_display_manager* dm)
     nodm_xserver_init(&dm->srv);
     nodm_xsession_init(&dm->session);
     nodm_vt_init(&dm->vt);
+    nodm_xserver_init(&dm->standby_srv);
+    nodm_vt_init(&dm->standby_vt);
+    dm->conf_standby = atoi(getenv_with_default("NODM_X_STANDBY", "0")) != 0;
+    dm->_standby_argv = NULL;
     dm->conf_minimum_session_time = atoi(getenv_with_default("NODM_MIN_SESSION_TIME", "60"));
     dm->_srv_split_args = NULL;
     dm->_srv_split_argv = NULL;
+    dm->loop_fd = -1;
+    dm->signal_fd = -1;
+    dm->timer_fd = -1;
+    dm->quit_requested = false;
+    dm->timer_expired = false;
+    dm->xserver_died = false;
+    dm->session_died = false;
+    dm->session_status = -1;
+    nodm_timing_init(&dm->timing);
 
     // Save original signal mask
     if (sigprocmask(SIG_BLOCK, NULL, &dm->orig_signal_mask) == -1)
         log_err("sigprocmask error: %m");
     dm->srv.orig_signal_mask = dm->orig_signal_mask;
+    dm->standby_srv.orig_signal_mask = dm->orig_signal_mask;
     dm->session.orig_signal_mask = dm->orig_signal_mask;
 }
 
+// Event sources watched by the event loop, stored in epoll_event.data.u32
+enum {
+    NODM_EV_SIGNAL,
+    NODM_EV_TIMER,
+    NODM_EV_XSERVER,
+    NODM_EV_XREADY,
+    NODM_EV_SESSION,
+    NODM_EV_STANDBY,
+    NODM_EV_STANDBY_READY,
+    NODM_EV_TIMING,
+};
+
+static int loop_watch(struct nodm_display_manager* dm, int fd, uint32_t source)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = source };
+    if (epoll_ctl(dm->loop_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        log_err("cannot add file descriptor %d to the event loop: %m", fd);
+        return E_OS_ERROR;
+    }
+    return E_SUCCESS;
+}
+
+/// Change the event source associated to an already watched file descriptor
+static int loop_rewatch(struct nodm_display_manager* dm, int fd, uint32_t source)
+{
+    if (fd == -1) return E_SUCCESS;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = source };
+    if (epoll_ctl(dm->loop_fd, EPOLL_CTL_MOD, fd, &ev) == -1)
+    {
+        log_err("cannot modify file descriptor %d in the event loop: %m", fd);
+        return E_OS_ERROR;
+    }
+    return E_SUCCESS;
+}
+
+static void loop_unwatch(struct nodm_display_manager* dm, int fd)
+{
+    if (dm->loop_fd == -1 || fd == -1) return;
+    if (epoll_ctl(dm->loop_fd, EPOLL_CTL_DEL, fd, NULL) == -1)
+        log_warn("cannot remove file descriptor %d from the event loop: %m", fd);
+}
+
+/// Arm the timer to expire after \a seconds, or disarm it if \a seconds is 0
+static int loop_set_timer(struct nodm_display_manager* dm, int seconds)
+{
+    struct itimerspec its = { .it_value = { .tv_sec = seconds, .tv_nsec = 0 } };
+    dm->timer_expired = false;
+    if (timerfd_settime(dm->timer_fd, 0, &its, NULL) == -1)
+    {
+        log_err("timerfd_settime error: %m");
+        return E_OS_ERROR;
+    }
+    return E_SUCCESS;
+}
+
+static int loop_setup(struct nodm_display_manager* dm)
+{
+    // Block all signals: the ones we care about are read via signalfd
+    sigset_t blockmask;
+    if (sigfillset(&blockmask) == -1)
+    {
+        log_err("sigfillset error: %m");
+        return E_PROGRAMMING;
+    }
+    if (sigprocmask(SIG_BLOCK, &blockmask, NULL) == -1)
+    {
+        log_err("sigprocmask error: %m");
+        return E_PROGRAMMING;
+    }
+
+    sigset_t handled;
+    if (sigemptyset(&handled)
+        || sigaddset(&handled, SIGTERM)
+        || sigaddset(&handled, SIGINT)
+        || sigaddset(&handled, SIGQUIT)
+        || sigaddset(&handled, SIGUSR1))
+    {
+        log_err("signal operations error: %m");
+        return E_PROGRAMMING;
+    }
+    dm->signal_fd = signalfd(-1, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (dm->signal_fd == -1)
+    {
+        log_err("cannot create signalfd: %m");
+        return E_OS_ERROR;
+    }
+
+    dm->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (dm->timer_fd == -1)
+    {
+        log_err("cannot create timerfd: %m");
+        return E_OS_ERROR;
+    }
+
+    dm->loop_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (dm->loop_fd == -1)
+    {
+        log_err("cannot create epoll file descriptor: %m");
+        return E_OS_ERROR;
+    }
+
+    int res = nodm_timing_open(&dm->timing);
+    if (res != E_SUCCESS) return res;
+
+    res = loop_watch(dm, dm->signal_fd, NODM_EV_SIGNAL);
+    if (res != E_SUCCESS) return res;
+    res = loop_watch(dm, dm->timing.fd, NODM_EV_TIMING);
+    if (res != E_SUCCESS) return res;
+    return loop_watch(dm, dm->timer_fd, NODM_EV_TIMER);
+}
+
+static void loop_shutdown(struct nodm_display_manager* dm)
+{
+    if (dm->signal_fd != -1)
+    {
+        // Consume pending signals, so that restoring the signal mask does not
+        // deliver them (like a late SIGUSR1 from an X server reset)
+        struct signalfd_siginfo si;
+        while (read(dm->signal_fd, &si, sizeof(si)) == sizeof(si))
+            ;
+        close(dm->signal_fd);
+        dm->signal_fd = -1;
+    }
+    if (dm->timer_fd != -1)
+    {
+        close(dm->timer_fd);
+        dm->timer_fd = -1;
+    }
+    nodm_timing_close(&dm->timing);
+    if (dm->loop_fd != -1)
+    {
+        close(dm->loop_fd);
+        dm->loop_fd = -1;
+    }
+}
+
+/// Called by the event loop when the standby X server becomes ready
+static void standby_ready(struct nodm_display_manager* dm)
+{
+    if (!dm->standby_srv.ready) return;
+    log_info("standby X server is ready on display %s", dm->standby_srv.name);
+
+    // Starting the standby server made its VT the active one: switch back to
+    // the one the session is using
+    if (dm->srv.pid != -1)
+        nodm_vt_activate(&dm->vt);
+}
+
+static void loop_handle_signals(struct nodm_display_manager* dm)
+{
+    struct signalfd_siginfo si;
+    while (read(dm->signal_fd, &si, sizeof(si)) == sizeof(si))
+    {
+        switch (si.ssi_signo)
+        {
+            case SIGTERM:
+            case SIGINT:
+            case SIGQUIT:
+                log_info("shutdown signal received");
+                dm->quit_requested = true;
+                break;
+            case SIGUSR1:
+                // The X server tells us it is ready, and tells us again at
+                // every reset
+                if ((pid_t)si.ssi_pid == dm->srv.pid
+                    && !dm->srv.conf_use_displayfd && !dm->srv.ready)
+                    nodm_xserver_handle_ready(&dm->srv);
+                else if ((pid_t)si.ssi_pid == dm->standby_srv.pid
+                    && !dm->standby_srv.conf_use_displayfd && !dm->standby_srv.ready)
+                {
+                    nodm_xserver_handle_ready(&dm->standby_srv);
+                    standby_ready(dm);
+                }
+                break;
+        }
+    }
+}
+
+/**
+ * Wait for events and process them, updating the state flags in \a dm.
+ *
+ * This is the only place where nodm waits for something to happen.
+ */
+static int loop_dispatch(struct nodm_display_manager* dm)
+{
+    struct epoll_event events[8];
+    int count = epoll_wait(dm->loop_fd, events, 8, -1);
+    if (count == -1)
+    {
+        if (errno == EINTR) return E_SUCCESS;
+        log_err("epoll_wait error: %m");
+        return E_OS_ERROR;
+    }
+
+    int res = E_SUCCESS;
+    for (int i = 0; i < count && res == E_SUCCESS; ++i)
+    {
+        switch (events[i].data.u32)
+        {
+            case NODM_EV_SIGNAL:
+                loop_handle_signals(dm);
+                break;
+            case NODM_EV_TIMER:
+            {
+                uint64_t expirations;
+                if (read(dm->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                    dm->timer_expired = true;
+                break;
+            }
+            case NODM_EV_XSERVER:
+            {
+                if (dm->srv.pid == -1) break;
+                int status;
+                loop_unwatch(dm, dm->srv.pidfd);
+                loop_unwatch(dm, dm->srv.ready_fd);
+                res = nodm_xserver_reap(&dm->srv, &status);
+                dm->xserver_died = true;
+                break;
+            }
+            case NODM_EV_XREADY:
+                // nodm_xserver_handle_ready closes ready_fd when done, which
+                // also removes it from the epoll set
+                if (dm->srv.ready_fd != -1)
+                    res = nodm_xserver_handle_ready(&dm->srv);
+                break;
+            case NODM_EV_SESSION:
+                if (dm->session.pid == -1) break;
+                loop_unwatch(dm, dm->session.pidfd);
+                res = nodm_xsession_reap(&dm->session, &dm->session_status);
+                dm->session_died = true;
+                break;
+            case NODM_EV_STANDBY:
+            {
+                if (dm->standby_srv.pid == -1) break;
+                // It will be started again at the next restart
+                int status;
+                log_warn("standby X server died");
+                loop_unwatch(dm, dm->standby_srv.pidfd);
+                loop_unwatch(dm, dm->standby_srv.ready_fd);
+                res = nodm_xserver_reap(&dm->standby_srv, &status);
+                break;
+            }
+            case NODM_EV_STANDBY_READY:
+                if (dm->standby_srv.ready_fd == -1) break;
+                res = nodm_xserver_handle_ready(&dm->standby_srv);
+                standby_ready(dm);
+                break;
+            case NODM_EV_TIMING:
+                res = nodm_timing_read(&dm->timing);
+                break;
+        }
+    }
+    return res;
+}
+
+/// Run the event loop for \a seconds, or until a quit signal arrives
+static int loop_sleep(struct nodm_display_manager* dm, int seconds)
+{
+    int res = loop_set_timer(dm, seconds);
+    if (res != E_SUCCESS) return res;
+
+    while (!dm->timer_expired)
+    {
+        if (dm->quit_requested)
+            return E_USER_QUIT;
+        res = loop_dispatch(dm);
+        if (res != E_SUCCESS) return res;
+    }
+    return E_SUCCESS;
+}
+
+static int stop_xserver(struct nodm_display_manager* dm)
+{
+    loop_unwatch(dm, dm->srv.pidfd);
+    loop_unwatch(dm, dm->srv.ready_fd);
+    return nodm_xserver_stop(&dm->srv);
+}
+
+static int stop_standby(struct nodm_display_manager* dm)
+{
+    loop_unwatch(dm, dm->standby_srv.pidfd);
+    loop_unwatch(dm, dm->standby_srv.ready_fd);
+    return nodm_xserver_stop(&dm->standby_srv);
+}
+
+/// Start the standby X server, without waiting for it to be ready
+static int spawn_standby(struct nodm_display_manager* dm)
+{
+    log_verb("starting standby X server");
+    int res = nodm_xserver_spawn(&dm->standby_srv);
+    if (res != E_SUCCESS) return res;
+
+    res = loop_watch(dm, dm->standby_srv.pidfd, NODM_EV_STANDBY);
+    if (res == E_SUCCESS && dm->standby_srv.ready_fd != -1)
+        res = loop_watch(dm, dm->standby_srv.ready_fd, NODM_EV_STANDBY_READY);
+    if (res != E_SUCCESS)
+        stop_standby(dm);
+    return res;
+}
+
+/**
+ * Exchange the current and the standby X servers, together with their VTs.
+ *
+ * The previous X server, which is expected to have been stopped, becomes the
+ * slot for the next standby server.
+ */
+static int swap_xservers(struct nodm_display_manager* dm)
+{
+    struct nodm_xserver srv = dm->srv;
+    dm->srv = dm->standby_srv;
+    dm->standby_srv = srv;
+
+    // Display names read via -displayfd point inside the structure
+    if (dm->srv.name == dm->standby_srv._namebuf)
+        dm->srv.name = dm->srv._namebuf;
+    if (dm->standby_srv.name == dm->srv._namebuf)
+        dm->standby_srv.name = dm->standby_srv._namebuf;
+
+    dm->srv.report_timing = true;
+    dm->standby_srv.report_timing = false;
+
+    struct nodm_vt vt = dm->vt;
+    dm->vt = dm->standby_vt;
+    dm->standby_vt = vt;
+
+    int res = loop_rewatch(dm, dm->srv.pidfd, NODM_EV_XSERVER);
+    if (res == E_SUCCESS)
+        res = loop_rewatch(dm, dm->srv.ready_fd, NODM_EV_XREADY);
+    if (res == E_SUCCESS)
+        res = loop_rewatch(dm, dm->standby_srv.pidfd, NODM_EV_STANDBY);
+    if (res == E_SUCCESS)
+        res = loop_rewatch(dm, dm->standby_srv.ready_fd, NODM_EV_STANDBY_READY);
+    return res;
+}
+
+/**
+ * Prepare the standby X server configuration: it runs on its own VT and on
+ * the display following the one of the main server.
+ */
+static int setup_standby(struct nodm_display_manager* dm)
+{
+    dm->standby_srv.conf_timeout = dm->srv.conf_timeout;
+    dm->standby_srv.conf_use_displayfd = dm->srv.conf_use_displayfd;
+    // Standby servers start outside of restart cycles
+    dm->standby_srv.report_timing = false;
+
+    int argc = 0;
+    while (dm->srv.argv[argc]) ++argc;
+
+    if (dm->vt.num != -1)
+    {
+        dm->standby_vt.conf_initial_vt = dm->vt.conf_initial_vt;
+        int res = nodm_vt_start(&dm->standby_vt);
+        if (res != E_SUCCESS) return res;
+        snprintf(dm->_standby_vtarg, sizeof(dm->_standby_vtarg), "vt%d", dm->standby_vt.num);
+        log_verb("allocated VT %d for the standby X server", dm->standby_vt.num);
+    } else {
+        for (int i = 0; i < argc; ++i)
+        {
+            int vtn;
+            if (sscanf(dm->srv.argv[i], "vt%d", &vtn) == 1)
+            {
+                log_warn("X server VT is set in the command line: disabling the standby X server");
+                dm->conf_standby = false;
+                return E_SUCCESS;
+            }
+        }
+    }
+
+    if (dm->srv.name != NULL)
+    {
+        int display;
+        if (sscanf(dm->srv.name, ":%d", &display) != 1)
+        {
+            log_warn("cannot parse display name %s: disabling the standby X server", dm->srv.name);
+            dm->conf_standby = false;
+            return E_SUCCESS;
+        }
+        snprintf(dm->_standby_name, sizeof(dm->_standby_name), ":%d", display + 1);
+        dm->standby_srv.name = dm->_standby_name;
+    }
+
+    dm->_standby_argv = (const char**)malloc((argc + 1) * sizeof(const char*));
+    if (dm->_standby_argv == NULL)
+    {
+        log_err("cannot allocate standby X server command line: %m");
+        return E_OS_ERROR;
+    }
+    for (int i = 0; i < argc; ++i)
+    {
+        if (dm->srv.argv[i] == dm->srv.name)
+            dm->_standby_argv[i] = dm->_standby_name;
+        else if (dm->srv.argv[i] == dm->_vtarg)
+            dm->_standby_argv[i] = dm->_standby_vtarg;
+        else
+            dm->_standby_argv[i] = dm->srv.argv[i];
+    }
+    dm->_standby_argv[argc] = NULL;
+    dm->standby_srv.argv = dm->_standby_argv;
+
+    return E_SUCCESS;
+}
+
+static int stop_xsession(struct nodm_display_manager* dm)
+{
+    loop_unwatch(dm, dm->session.pidfd);
+    return nodm_xsession_stop(&dm->session);
+}
+
 void nodm_display_manager_cleanup(struct nodm_display_manager* dm)
 {
+    stop_standby(dm);
+    loop_shutdown(dm);
+
     // Restore original signal mask
     if (sigprocmask(SIG_SETMASK, &dm->orig_signal_mask, NULL) == -1)
         log_err("sigprocmask error: %m");
 
     nodm_vt_stop(&dm->vt);
+    nodm_vt_stop(&dm->standby_vt);
+
+    if (dm->_standby_argv)
+    {
+        free(dm->_standby_argv);
+        dm->_standby_argv = NULL;
+    }
 
     // Deallocate parsed arguments, if used
     if (dm->_srv_split_args)
@@ -91,19 +529,15 @@ int nodm_display_manager_start(struct nodm_display_manager* dm)
     } else
         log_verb("skipped VT allocation");
 
-    // Block all signals
-    sigset_t blockmask;
-    if (sigfillset(&blockmask) == -1)
-    {
-        log_err("sigfillset error: %m");
-        return E_PROGRAMMING;
-    }
-    if (sigprocmask(SIG_BLOCK, &blockmask, NULL) == -1)
+    if (dm->conf_standby)
     {
-        log_err("sigprocmask error: %m");
-        return E_PROGRAMMING;
+        res = setup_standby(dm);
+        if (res != E_SUCCESS) return res;
     }
 
+    res = loop_setup(dm);
+    if (res != E_SUCCESS) return res;
+
     res = nodm_display_manager_restart(dm);
     if (res != E_SUCCESS) return res;
 
@@ -113,122 +547,120 @@ int nodm_display_manager_start(struct nodm_display_manager* dm)
 int nodm_display_manager_restart(struct nodm_display_manager* dm)
 {
     dm->last_session_start = time(NULL);
+    nodm_timing_start_cycle(&dm->timing);
+    dm->xserver_died = false;
+    dm->session_died = false;
+    dm->session_status = -1;
 
-    int res = nodm_xserver_start(&dm->srv);
-    if (res != E_SUCCESS) return res;
+    int res;
+    bool promoted = false;
+    if (dm->conf_standby && dm->standby_srv.pid != -1)
+    {
+        // Take over the standby server, which is ready or at least already
+        // starting up
+        log_info("switching to standby X server");
+        res = swap_xservers(dm);
+        if (res != E_SUCCESS) goto xserver_failed;
+        promoted = true;
+    } else {
+        res = nodm_xserver_spawn(&dm->srv);
+        if (res != E_SUCCESS) return res;
+
+        res = loop_watch(dm, dm->srv.pidfd, NODM_EV_XSERVER);
+        if (res != E_SUCCESS) goto xserver_failed;
+        if (dm->srv.ready_fd != -1)
+        {
+            res = loop_watch(dm, dm->srv.ready_fd, NODM_EV_XREADY);
+            if (res != E_SUCCESS) goto xserver_failed;
+        }
+    }
+
+    // Wait for the server to be ready, to die or for a timeout
+    res = loop_set_timer(dm, dm->srv.conf_timeout);
+    if (res != E_SUCCESS) goto xserver_failed;
+    while (!dm->srv.ready)
+    {
+        res = loop_dispatch(dm);
+        if (res != E_SUCCESS) break;
+        if (dm->xserver_died)
+        {
+            res = E_X_SERVER_DIED;
+            break;
+        }
+        if (dm->quit_requested)
+        {
+            res = E_USER_QUIT;
+            break;
+        }
+        if (dm->timer_expired)
+        {
+            log_err("X server did not respond after %u seconds", dm->srv.conf_timeout);
+            res = E_X_SERVER_TIMEOUT;
+            break;
+        }
+    }
+    loop_set_timer(dm, 0);
+    if (res != E_SUCCESS) goto xserver_failed;
     log_verb("X server is ready for connections");
 
+    if (promoted)
+        nodm_vt_activate(&dm->vt);
+
+    uint64_t connect_start = nodm_timing_now();
+    res = nodm_xserver_connect(&dm->srv);
+    if (res != E_SUCCESS) goto xserver_failed;
+    nodm_timing_report(NODM_PHASE_X_CONNECT, connect_start, nodm_timing_now());
+
     res = nodm_xsession_start(&dm->session, &dm->srv);
     if (res != E_SUCCESS) return res;
+    res = loop_watch(dm, dm->session.pidfd, NODM_EV_SESSION);
+    if (res != E_SUCCESS) return res;
     log_verb("X session has started");
 
+    if (dm->conf_standby && dm->standby_srv.pid == -1)
+        if (spawn_standby(dm) != E_SUCCESS)
+            log_warn("cannot start standby X server: will try again at the next restart");
+
     return E_SUCCESS;
+
+xserver_failed:
+    stop_xserver(dm);
+    return res;
 }
 
 int nodm_display_manager_stop(struct nodm_display_manager* dm)
 {
-    int res = nodm_xsession_stop(&dm->session);
+    int res = stop_xsession(dm);
     if (res != E_SUCCESS) return res;
 
-    res = nodm_xserver_stop(&dm->srv);
+    res = stop_xserver(dm);
     if (res != E_SUCCESS) return res;
 
     return E_SUCCESS;
 }
 
-// Signal handler for wait loop
-static int quit_signal_caught = 0;
-static void catch_signals (int sig)
-{
-    ++quit_signal_caught;
-}
-
-static int setup_quit_notification(sigset_t* origset)
-{
-    /* Reset caught signal flag */
-    quit_signal_caught = 0;
-
-    struct sigaction action;
-    action.sa_handler = catch_signals;
-    sigemptyset (&action.sa_mask);
-    action.sa_flags = 0;
-
-    sigset_t ourset;
-    if (sigemptyset(&ourset)
-        || sigaddset(&ourset, SIGTERM)
-        || sigaddset(&ourset, SIGINT)
-        || sigaddset(&ourset, SIGQUIT)
-        || sigaction(SIGTERM, &action, NULL)
-        || sigaction(SIGINT, &action, NULL)
-        || sigaction(SIGQUIT, &action, NULL)
-        || sigprocmask(SIG_UNBLOCK, &ourset, origset)
-        ) {
-        log_err("signal operations error: %m");
-        return E_PROGRAMMING;
-    }
-    return E_SUCCESS;
-}
-
-static void shutdown_quit_notification(const sigset_t* origset)
-{
-    if (sigprocmask(SIG_SETMASK, origset, NULL) == -1)
-        log_err("sigprocmask error: %m");
-}
-
 int nodm_display_manager_wait(struct nodm_display_manager* dm, int* session_status)
 {
-    int res = E_SUCCESS;
-
-    // Catch the normal termination signals using 'catch_signals'
-    sigset_t origset;
-    res = setup_quit_notification(&origset);
-    if (res != E_SUCCESS) return res;
-
     *session_status = -1;
     while (true)
     {
-        // Wait for one child to exit
-        int status;
-        pid_t child = waitpid(-1, &status, 0);
-        if (child == -1)
+        if (dm->xserver_died)
         {
-            if (errno == EINTR)
-            {
-                if (quit_signal_caught)
-                {
-                    log_info("shutdown signal received");
-                    res = E_USER_QUIT;
-                    goto cleanup;
-                }
-                else
-                    continue;
-            }
-            else
-            {
-                log_warn("waitpid error: %m");
-                res = E_OS_ERROR;
-                goto cleanup;
-            }
+            dm->xserver_died = false;
+            return E_X_SERVER_DIED;
         }
-
-        if (child == dm->srv.pid)
+        if (dm->session_died)
         {
-            // Server died
-            nodm_xserver_report_exit(&dm->srv, status);
-            res = E_X_SERVER_DIED;
-            goto cleanup;
-        } else if (child == dm->session.pid) {
-            // Session died
-            nodm_xsession_report_exit(&dm->session, status);
-            *session_status = status;
-            res = E_SESSION_DIED;
-            goto cleanup;
+            dm->session_died = false;
+            *session_status = dm->session_status;
+            return E_SESSION_DIED;
         }
-    }
+        if (dm->quit_requested)
+            return E_USER_QUIT;
 
-cleanup:
-    shutdown_quit_notification(&origset);
-    return res;
+        int res = loop_dispatch(dm);
+        if (res != E_SUCCESS) return res;
+    }
 }
 
 int nodm_display_manager_parse_xcmdline(struct nodm_display_manager* s, const char* xcmdline)
@@ -276,6 +708,9 @@ int nodm_display_manager_parse_xcmdline(struct nodm_display_manager* s, const ch
         s->srv.name = argv[argc];
         ++argc;
     }
+    else if (s->srv.conf_use_displayfd)
+        // The server will pick a free display and tell us via -displayfd
+        s->srv.name = NULL;
     else
     {
         argv[argc] = ":0";
@@ -317,43 +752,11 @@ cleanup:
 void nodm_display_manager_dump_status(struct nodm_display_manager* dm)
 {
     nodm_xserver_dump_status(&dm->srv);
+    fprintf(stderr, "standby X server: %s\n", dm->conf_standby ? "yes" : "no");
+    if (dm->conf_standby)
+        nodm_xserver_dump_status(&dm->standby_srv);
     nodm_xsession_dump_status(&dm->session);
-}
-
-static int interruptible_sleep(int seconds)
-{
-    int res = E_SUCCESS;
-
-    // Catch the normal termination signals using 'catch_signals'
-    sigset_t origset;
-    res = setup_quit_notification(&origset);
-    if (res != E_SUCCESS) return res;
-
-    struct timespec tosleep = { .tv_sec = seconds, .tv_nsec = 0 };
-    struct timespec remaining;
-    while (true)
-    {
-        int r = nanosleep(&tosleep, &remaining);
-        if (r != -1)
-            break;
-        else if (errno == EINTR)
-        {
-            if (quit_signal_caught)
-            {
-                res = E_USER_QUIT;
-                break;
-            } else
-                tosleep = remaining;
-        }
-        else
-        {
-            log_warn("sleep aborted: %m (ignoring error");
-            break;
-        }
-    }
-
-    shutdown_quit_notification(&origset);
-    return res;
+    nodm_timing_dump_status(&dm->timing);
 }
 
 int nodm_display_manager_wait_restart_loop(struct nodm_display_manager* dm)
@@ -393,7 +796,7 @@ int nodm_display_manager_wait_restart_loop(struct nodm_display_manager* dm)
         {
             log_warn("session lasted less than %d seconds: sleeping %d seconds before restarting it",
                     dm->conf_minimum_session_time, retry_times[restart_count]);
-            res = interruptible_sleep(retry_times[restart_count]);
+            res = loop_sleep(dm, retry_times[restart_count]);
             if (res != E_SUCCESS) return res;
         }
 
@@ -24,6 +24,8 @@
 #include "xserver.h"
 #include "xsession.h"
 #include "vt.h"
+#include "timing.h"
+#include <stdbool.h>
 #include <time.h>
 #include <signal.h>
 
@@ -38,6 +40,15 @@ struct nodm_display_manager
     /// VT allocation
     struct nodm_vt vt;
 
+    /// If true, keep a standby X server ready to replace the current one
+    bool conf_standby;
+
+    /// Pre-started X server that takes over when srv needs restarting
+    struct nodm_xserver standby_srv;
+
+    /// VT allocation for the standby X server
+    struct nodm_vt standby_vt;
+
     /**
      * The minimum time (in seconds) that a session should last to be
      * considered successful
@@ -50,12 +61,38 @@ struct nodm_display_manager
     /// Original signal mask at program startup
     sigset_t orig_signal_mask;
 
+    /// epoll file descriptor of the event loop
+    int loop_fd;
+    /// signalfd for the signals handled by the event loop
+    int signal_fd;
+    /// timerfd used for X startup timeouts and restart backoff
+    int timer_fd;
+
+    /// Set by the event loop when a quit signal is received
+    bool quit_requested;
+    /// Set by the event loop when the timer expires
+    bool timer_expired;
+    /// Set by the event loop when it reaps the X server
+    bool xserver_died;
+    /// Set by the event loop when it reaps the X session
+    bool session_died;
+    /// Exit status of the X session, when session_died is set
+    int session_status;
+
+    /// Startup phase timings
+    struct nodm_timing timing;
+
     /// Storage for split server arguments used by nodm_x_cmdline_split
     char** _srv_split_argv;
     void* _srv_split_args;
 
     /// Storage for vtN argument from dynamic VT allocation
     char _vtarg[10];
+
+    /// Storage for the standby server command line, display name and vtN
+    const char** _standby_argv;
+    char _standby_name[16];
+    char _standby_vtarg[10];
 };
 
 /// Initialise a display_manager structure with default values
@@ -67,15 +104,30 @@ void nodm_display_manager_cleanup(struct nodm_display_manager* dm);
 /**
  * Start X and the X session
  *
- * This function sets the signal mask to block all signals. The original signal
- * mask is restored by nodm_display_manager_cleanup().
+ * This function sets the signal mask to block all signals, and sets up the
+ * event loop that receives them via signalfd. The original signal mask is
+ * restored by nodm_display_manager_cleanup().
  */
 int nodm_display_manager_start(struct nodm_display_manager* dm);
 
-/// Restart X and the X session after they died
+/**
+ * Restart X and the X session after they died
+ *
+ * It runs the event loop until the X server is ready for connections, then
+ * starts the X session.
+ *
+ * If conf_standby is set and a standby X server is running, it takes over
+ * instead of starting a new server, and a new standby server is started in
+ * the background once the session is running.
+ */
 int nodm_display_manager_restart(struct nodm_display_manager* dm);
 
-/// Wait for X or the X session to end
+/**
+ * Run the event loop until X or the X session end, or a quit signal arrives
+ *
+ * @retval session_status
+ *   the X session exit status if it ended, else -1
+ */
 int nodm_display_manager_wait(struct nodm_display_manager* dm, int* session_status);
 
 /// Stop X and the X session
@@ -99,7 +151,8 @@ int nodm_display_manager_wait_restart_loop(struct nodm_display_manager* dm);
  *
  * If the second token (or the first if the first was not recognised as a path
  * to the X server) looks like ":<NUMBER>", it is used as the display name,
- * else ":0" is used.
+ * else ":0" is used. If dm->srv.conf_use_displayfd is set, no display name is
+ * added, and the X server is left to choose one.
  */
 int nodm_display_manager_parse_xcmdline(struct nodm_display_manager* dm, const char* xcmdline);
 
@@ -22,6 +22,7 @@
 #include "common.h"
 #include "dm.h"
 #include "test.h"
+#include "timing.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -160,5 +161,49 @@ int main(int argc, char* argv[])
     ensure_equali(s.vt.conf_initial_vt, -1);
     nodm_display_manager_cleanup(&s);
 
+    // With -displayfd, the server chooses the display unless one is given
+    nodm_display_manager_init(&s);
+    s.srv.conf_use_displayfd = true;
+    nodm_display_manager_parse_xcmdline(&s, "/usr/bin/Xnest foo");
+    ensure_equals(s.srv.argv[0], "/usr/bin/Xnest");
+    ensure_equals(s.srv.argv[1], "foo");
+    ensure_equals(s.srv.argv[2], NULL);
+    ensure_equals(s.srv.name, NULL);
+    nodm_display_manager_cleanup(&s);
+
+    nodm_display_manager_init(&s);
+    s.srv.conf_use_displayfd = true;
+    nodm_display_manager_parse_xcmdline(&s, ":2 foo");
+    ensure_equals(s.srv.argv[0], "/usr/bin/X");
+    ensure_equals(s.srv.argv[1], ":2");
+    ensure_equals(s.srv.argv[2], "foo");
+    ensure_equals(s.srv.argv[3], NULL);
+    ensure_equals(s.srv.name, ":2");
+    nodm_display_manager_cleanup(&s);
+
+    // Phase reports are collected through the pipe, and only for the
+    // current cycle
+    struct nodm_timing t;
+    nodm_timing_init(&t);
+    ensure_succeeds(nodm_timing_open(&t));
+    nodm_timing_start_cycle(&t);
+    nodm_timing_report(NODM_PHASE_X_FORK, 100, 300);
+    nodm_timing_report(NODM_PHASE_PAM, 1000, 1500);
+    ensure_succeeds(nodm_timing_read(&t));
+    ensure_equali(t.duration[NODM_PHASE_X_FORK], 200);
+    ensure_equali(t.duration[NODM_PHASE_PAM], 500);
+    ensure_equali(t.duration[NODM_PHASE_X_READY], 0);
+    nodm_timing_report(NODM_PHASE_SESSION_EXEC, t.cycle_start, t.cycle_start + 3000);
+    ensure_succeeds(nodm_timing_read(&t));
+    ensure_equali(t.phase_stats[NODM_PHASE_PAM].count, 1);
+    ensure_equali(t.phase_stats[NODM_PHASE_PAM].max, 500);
+    ensure_equali(t.total_stats.count, 1);
+    ensure_equali(t.total_stats.max, 3000);
+    nodm_timing_report(NODM_PHASE_PAM, 1000, 1100);
+    nodm_timing_start_cycle(&t);
+    ensure_succeeds(nodm_timing_read(&t));
+    ensure_equali(t.duration[NODM_PHASE_PAM], 0);
+    nodm_timing_close(&t);
+
     test_ok();
 }
@@ -0,0 +1,210 @@
+/*
+ * timing - startup latency instrumentation
+ *
+ * Copyright 2011  Enrico Zini <enrico@enricozini.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+#include "timing.h"
+#include "common.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Record sent through the report pipe
+struct report
+{
+    unsigned cycle;
+    enum nodm_phase phase;
+    uint64_t start;
+    uint64_t end;
+};
+
+// Write end of the report pipe, inherited by child processes
+static int report_fd = -1;
+// Current cycle number, inherited by child processes
+static unsigned report_cycle = 0;
+
+static const char* phase_names[NODM_PHASE_COUNT] = {
+    "X fork",
+    "X exec",
+    "X ready",
+    "X connect",
+    "getpwnam",
+    "PAM",
+    "WINDOWPATH",
+    "session exec",
+};
+
+uint64_t nodm_timing_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+const char* nodm_timing_phase_name(enum nodm_phase phase)
+{
+    if (phase < 0 || phase >= NODM_PHASE_COUNT)
+        return "unknown";
+    return phase_names[phase];
+}
+
+void nodm_timing_init(struct nodm_timing* t)
+{
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+}
+
+int nodm_timing_open(struct nodm_timing* t)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        log_err("cannot create timing report pipe: %m");
+        return E_OS_ERROR;
+    }
+    t->fd = fds[0];
+    report_fd = fds[1];
+    return E_SUCCESS;
+}
+
+void nodm_timing_close(struct nodm_timing* t)
+{
+    if (t->fd != -1)
+    {
+        close(t->fd);
+        t->fd = -1;
+    }
+    if (report_fd != -1)
+    {
+        close(report_fd);
+        report_fd = -1;
+    }
+}
+
+void nodm_timing_start_cycle(struct nodm_timing* t)
+{
+    ++report_cycle;
+    t->cycle_start = nodm_timing_now();
+    memset(t->duration, 0, sizeof(t->duration));
+    t->total = 0;
+}
+
+void nodm_timing_report(enum nodm_phase phase, uint64_t start, uint64_t end)
+{
+    if (report_fd == -1) return;
+    struct report r = {
+        .cycle = report_cycle,
+        .phase = phase,
+        .start = start,
+        .end = end,
+    };
+    // Writes smaller than PIPE_BUF are atomic, and if the pipe is full the
+    // report is dropped
+    if (write(report_fd, &r, sizeof(r)) != sizeof(r))
+        return;
+}
+
+int nodm_timing_read(struct nodm_timing* t)
+{
+    struct report r;
+    while (true)
+    {
+        ssize_t res = read(t->fd, &r, sizeof(r));
+        if (res == -1)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) break;
+            log_err("cannot read timing reports: %m");
+            return E_OS_ERROR;
+        }
+        if (res != sizeof(r))
+            break;
+        if (r.cycle != report_cycle || r.phase < 0 || r.phase >= NODM_PHASE_COUNT)
+            continue;
+
+        nodm_timing_record(t, r.phase, r.end > r.start ? r.end - r.start : 0);
+        if (r.phase == NODM_PHASE_SESSION_EXEC)
+        {
+            // The session is running: this is the end of the cycle
+            t->total = r.end > t->cycle_start ? r.end - t->cycle_start : 0;
+            nodm_timing_end_cycle(t);
+        }
+    }
+    return E_SUCCESS;
+}
+
+static void stats_add(struct nodm_timing_stats* s, uint64_t val)
+{
+    if (s->count == 0 || val < s->min) s->min = val;
+    if (s->count == 0 || val > s->max) s->max = val;
+    s->total += val;
+    ++s->count;
+}
+
+void nodm_timing_record(struct nodm_timing* t, enum nodm_phase phase, uint64_t duration)
+{
+    // Use at least 1us, so that 0 means 'not reached'
+    t->duration[phase] = duration ? duration : 1;
+}
+
+void nodm_timing_end_cycle(struct nodm_timing* t)
+{
+    char buf[512];
+    int pos = 0;
+    buf[0] = 0;
+    for (int i = 0; i < NODM_PHASE_COUNT && pos < sizeof(buf); ++i)
+    {
+        if (t->duration[i] == 0) continue;
+        stats_add(&t->phase_stats[i], t->duration[i]);
+        int r = snprintf(buf + pos, sizeof(buf) - pos, ", %s %.1fms",
+                phase_names[i], t->duration[i] / 1000.0);
+        if (r < 0) break;
+        pos += r;
+    }
+
+    stats_add(&t->total_stats, t->total);
+    const struct nodm_timing_stats* s = &t->total_stats;
+    log_info("startup took %.1fms (min %.1fms avg %.1fms max %.1fms over %u cycles)%s",
+            t->total / 1000.0,
+            s->min / 1000.0, s->total / 1000.0 / s->count, s->max / 1000.0, s->count,
+            buf);
+
+    memset(t->duration, 0, sizeof(t->duration));
+    t->total = 0;
+}
+
+static void dump_stats(const char* name, const struct nodm_timing_stats* s)
+{
+    if (s->count == 0)
+        fprintf(stderr, "timing %s: no data\n", name);
+    else
+        fprintf(stderr, "timing %s: min %.1fms avg %.1fms max %.1fms over %u cycles\n",
+                name, s->min / 1000.0, s->total / 1000.0 / s->count, s->max / 1000.0, s->count);
+}
+
+void nodm_timing_dump_status(struct nodm_timing* t)
+{
+    for (int i = 0; i < NODM_PHASE_COUNT; ++i)
+        dump_stats(phase_names[i], &t->phase_stats[i]);
+    dump_stats("total", &t->total_stats);
+}
@@ -0,0 +1,137 @@
+/*
+ * timing - startup latency instrumentation
+ *
+ * Copyright 2011  Enrico Zini <enrico@enricozini.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef NODM_TIMING_H
+#define NODM_TIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Phases of a startup cycle
+enum nodm_phase {
+    /// Forking the X server
+    NODM_PHASE_X_FORK,
+    /// From fork to exec in the X server child
+    NODM_PHASE_X_EXEC,
+    /// From fork to the X server readiness notification
+    NODM_PHASE_X_READY,
+    /// Connecting to the X server
+    NODM_PHASE_X_CONNECT,
+    /// Looking up the session user
+    NODM_PHASE_GETPWNAM,
+    /// Setting up the PAM session
+    NODM_PHASE_PAM,
+    /// Reading WINDOWPATH from the X server
+    NODM_PHASE_WINDOWPATH,
+    /// From fork to exec in the X session child
+    NODM_PHASE_SESSION_EXEC,
+    NODM_PHASE_COUNT
+};
+
+/// Running statistics about a duration, in microseconds
+struct nodm_timing_stats
+{
+    unsigned count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t total;
+};
+
+/// Collect phase timings for startup cycles
+struct nodm_timing
+{
+    /// Start of the current cycle (monotonic microseconds)
+    uint64_t cycle_start;
+
+    /// Duration of each phase in the current cycle, 0 if not reached yet
+    uint64_t duration[NODM_PHASE_COUNT];
+
+    /// Time from the start of the current cycle to the session exec
+    uint64_t total;
+
+    /// Statistics for each phase
+    struct nodm_timing_stats phase_stats[NODM_PHASE_COUNT];
+
+    /// Statistics for the time from the cycle start to the session exec
+    struct nodm_timing_stats total_stats;
+
+    /// Read end of the pipe where phase reports are received (-1 if closed)
+    int fd;
+};
+
+/// Monotonic clock in microseconds
+uint64_t nodm_timing_now();
+
+/// Return the name of a phase
+const char* nodm_timing_phase_name(enum nodm_phase phase);
+
+/// Initialise a struct nodm_timing
+void nodm_timing_init(struct nodm_timing* t);
+
+/**
+ * Create the pipe used by nodm_timing_report, setting t->fd.
+ *
+ * The write end is close-on-exec and non-blocking, so it is inherited by
+ * child processes only until they exec, and a full pipe only causes reports
+ * to be dropped.
+ */
+int nodm_timing_open(struct nodm_timing* t);
+
+/// Close the report pipe
+void nodm_timing_close(struct nodm_timing* t);
+
+/**
+ * Start a new cycle.
+ *
+ * Reports sent for previous cycles are ignored from now on.
+ */
+void nodm_timing_start_cycle(struct nodm_timing* t);
+
+/**
+ * Report that \a phase took place between \a start and \a end.
+ *
+ * This can be called from nodm or from any of its children before they exec:
+ * the report is sent through the pipe and collected by nodm_timing_read. It
+ * does nothing if the pipe has not been opened.
+ */
+void nodm_timing_report(enum nodm_phase phase, uint64_t start, uint64_t end);
+
+/**
+ * Read and account all pending reports.
+ *
+ * When the session exec is reported, a summary of the cycle is logged and
+ * the statistics are updated.
+ */
+int nodm_timing_read(struct nodm_timing* t);
+
+/// Account the duration of a phase in the current cycle
+void nodm_timing_record(struct nodm_timing* t, enum nodm_phase phase, uint64_t duration);
+
+/**
+ * Log a summary of the current cycle and update the statistics.
+ *
+ * t->total is expected to be set to the total duration of the cycle.
+ */
+void nodm_timing_end_cycle(struct nodm_timing* t);
+
+/// Dump all internal status to stderr
+void nodm_timing_dump_status(struct nodm_timing* t);
+
+#endif
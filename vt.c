@@ -105,6 +105,20 @@ int nodm_vt_start(struct nodm_vt* vt)
     return E_SUCCESS;
 }
 
+int nodm_vt_activate(struct nodm_vt* vt)
+{
+    if (vt->fd == -1)
+        return E_SUCCESS;
+
+    if (ioctl(vt->fd, VT_ACTIVATE, vt->num) < 0)
+    {
+        log_err("cannot switch to VT %d: %m", vt->num);
+        return E_OS_ERROR;
+    }
+
+    return E_SUCCESS;
+}
+
 void nodm_vt_stop(struct nodm_vt* vt)
 {
     if (vt->fd != -1)
@@ -42,6 +42,9 @@ void nodm_vt_init(struct nodm_vt* vt);
 /// Allocate a virtual terminal and keep it open
 int nodm_vt_start(struct nodm_vt* vt);
 
+/// Make the allocated virtual terminal the active one
+int nodm_vt_activate(struct nodm_vt* vt);
+
 /// Release the virtual terminal
 void nodm_vt_stop(struct nodm_vt* vt);
 
@@ -51,12 +51,18 @@
 #include "xserver.h"
 #include "common.h"
 #include "log.h"
+#include "timing.h"
 #include <signal.h>
+#include <stdbool.h>
 #include <time.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
 #include <unistd.h>
 #include <X11/Xfuncproto.h>
 #include <X11/Xatom.h>
@@ -65,65 +71,76 @@
 #include <setjmp.h>
 
 
-// Signal handlers
-static bool server_started = false;
-static void on_sigusr1(int sig) { server_started = true; }
-static void on_sigchld(int sig) {}
-
 void nodm_xserver_init(struct nodm_xserver* srv)
 {
     // Get the user we should run the session for
     srv->conf_timeout = atoi(getenv_with_default("NODM_X_TIMEOUT", "30"));
+    srv->conf_use_displayfd = atoi(getenv_with_default("NODM_X_DISPLAYFD", "0")) != 0;
     srv->argv = 0;
     srv->name = 0;
     srv->pid = -1;
+    srv->pidfd = -1;
+    srv->ready_fd = -1;
+    srv->ready = false;
+    srv->start_time = 0;
+    srv->report_timing = true;
     srv->dpy = NULL;
     srv->windowpath = NULL;
+    srv->_namebuf[0] = 0;
+    srv->_readybuf_len = 0;
     if (sigemptyset(&srv->orig_signal_mask) == -1)
         log_err("sigemptyset error: %m");
 }
 
-int nodm_xserver_start(struct nodm_xserver* srv)
+int nodm_xserver_spawn(struct nodm_xserver* srv)
 {
     // Function return code
     int return_code = E_SUCCESS;
-    // True if we should restore the signal mask at exit
-    bool signal_mask_altered = false;
-
-    // Initialise common signal handling machinery
-    struct sigaction sa;
-    sa.sa_flags = 0;
-    if (sigemptyset(&sa.sa_mask) < 0)
-    {
-        log_err("sigemptyset failed: %m");
-        return E_PROGRAMMING;
-    }
-
-    // Take note of the old SIGCHLD handler
-    struct sigaction sa_sigchld_old;
-    if (sigaction(SIGCHLD, NULL, &sa_sigchld_old) == -1)
+    // Command line actually run, with -displayfd appended if needed
+    const char** argv = srv->argv;
+    // -displayfd pipe
+    int readypipe[2] = { -1, -1 };
+    char readyfdarg[16];
+
+    srv->ready = false;
+    srv->_readybuf_len = 0;
+    // A display name read via -displayfd is not valid for the new server
+    if (srv->name == srv->_namebuf)
+        srv->name = NULL;
+
+    if (srv->conf_use_displayfd)
     {
-        log_err("sigaction failed: %m");
-        return E_PROGRAMMING;
-    }
+        if (pipe2(readypipe, O_CLOEXEC) == -1)
+        {
+            log_err("cannot create -displayfd pipe: %m");
+            return_code = E_OS_ERROR;
+            goto cleanup;
+        }
+        snprintf(readyfdarg, sizeof(readyfdarg), "%d", readypipe[1]);
 
-    // Catch server ready notifications via SIGUSR1
-    struct sigaction sa_usr1_old;
-    server_started = false;
-    sa.sa_handler = on_sigusr1;
-    if (sigaction(SIGUSR1, &sa, &sa_usr1_old) == -1)
-    {
-        log_err("sigaction failed: %m");
-        return E_PROGRAMMING;
+        // Append "-displayfd N" to the server command line
+        int argc = 0;
+        while (srv->argv[argc]) ++argc;
+        argv = (const char**)malloc((argc + 3) * sizeof(const char*));
+        if (argv == NULL)
+        {
+            log_err("cannot allocate X server command line: %m");
+            return_code = E_OS_ERROR;
+            goto cleanup;
+        }
+        for (int i = 0; i < argc; ++i)
+            argv[i] = srv->argv[i];
+        argv[argc] = "-displayfd";
+        argv[argc + 1] = readyfdarg;
+        argv[argc + 2] = NULL;
     }
-    // From now on we need to perform cleanup before returning
 
     if (log_verb(NULL))
     {
         // Log the concatenated command line
         char buf[4096];
         int pos = 0;
-        const char** s = srv->argv;
+        const char** s = argv;
         for ( ; *s && pos < 4096; ++s)
         {
             int r = snprintf(buf + pos, 4096 - pos, " %s", *s);
@@ -133,10 +150,12 @@ int nodm_xserver_start(struct nodm_xserver* srv)
         log_verb("starting X server %s", buf);
     }
     // fork/exec the X server
+    uint64_t fork_start = nodm_timing_now();
     srv->pid = fork ();
     if (srv->pid == 0)
     {
         // child
+        uint64_t child_start = nodm_timing_now();
 
         // Restore the original signal mask
         if (sigprocmask(SIG_SETMASK, &srv->orig_signal_mask, NULL) == -1)
@@ -149,15 +168,24 @@ int nodm_xserver_start(struct nodm_xserver* srv)
         signal(SIGTTIN, SIG_IGN);
         signal(SIGTTOU, SIG_IGN);
 
-        // Ignore SIGUSR1 to signal the X server that it should send us SIGUSR1
-        // when ready
-        signal(SIGUSR1, SIG_IGN);
+        if (srv->conf_use_displayfd)
+        {
+            // Let the -displayfd pipe survive exec, and leave SIGUSR1 alone
+            // so that the server does not signal us
+            fcntl(readypipe[1], F_SETFD, 0);
+            signal(SIGUSR1, SIG_DFL);
+        } else
+            // Ignore SIGUSR1 to signal the X server that it should send us
+            // SIGUSR1 when ready
+            signal(SIGUSR1, SIG_IGN);
 
         // prevent the server from getting sighup from vhangup() (from xinit)
         setpgid(0, getpid());
 
-        execv(srv->argv[0], (char *const*)srv->argv);
-        log_err("cannot start %s: %m", srv->argv[0]);
+        if (srv->report_timing)
+            nodm_timing_report(NODM_PHASE_X_EXEC, child_start, nodm_timing_now());
+        execv(argv[0], (char *const*)argv);
+        log_err("cannot start %s: %m", argv[0]);
         exit(errno == ENOENT ? E_CMD_NOTFOUND : E_CMD_NOEXEC);
     } else if (srv->pid == -1) {
         log_err("cannot fork to run %s: %m", srv->argv[0]);
@@ -165,77 +193,199 @@ int nodm_xserver_start(struct nodm_xserver* srv)
         goto cleanup;
     }
 
-    // Get notified on sigchld, so nanosleep later will exit with EINTR if the
-    // X server dies. If the server died before we set this signal handler,
-    // that's fine, since waitpid will notice it anyway
-    sa.sa_handler = on_sigchld;
-    if (sigaction(SIGCHLD, &sa, NULL) == -1)
+    srv->start_time = nodm_timing_now();
+    if (srv->report_timing)
+        nodm_timing_report(NODM_PHASE_X_FORK, fork_start, srv->start_time);
+
+    srv->pidfd = nodm_pidfd_open(srv->pid);
+    if (srv->pidfd == -1)
     {
-        log_err("sigaction failed: %m");
-        return_code = E_PROGRAMMING;
+        log_err("cannot open pidfd for %s: %m", srv->argv[0]);
+        return_code = E_OS_ERROR;
         goto cleanup;
     }
 
-    // Unblock SIGCHLD and SIGUSR1
-    sigset_t orig_set;
-    sigset_t cur_set;
-    if (sigemptyset(&cur_set) == -1)
+    if (srv->conf_use_displayfd)
     {
-        log_err("sigemptyset failed: %m");
-        return_code = E_PROGRAMMING;
-        goto cleanup;
+        // Only the server should keep the write end open, so that we get EOF
+        // if it goes away
+        srv->ready_fd = readypipe[0];
+        readypipe[0] = -1;
+    }
+
+cleanup:
+    // Release the -displayfd pipe and command line
+    if (readypipe[0] != -1) close(readypipe[0]);
+    if (readypipe[1] != -1) close(readypipe[1]);
+    if (argv != srv->argv) free(argv);
+
+    // Kill the X server if an error happened
+    if (srv->pid > 0 && return_code != E_SUCCESS)
+        nodm_xserver_stop(srv);
+
+    return return_code;
+}
+
+int nodm_xserver_handle_ready(struct nodm_xserver* srv)
+{
+    if (!srv->conf_use_displayfd)
+    {
+        srv->ready = true;
+        if (srv->report_timing)
+            nodm_timing_report(NODM_PHASE_X_READY, srv->start_time, nodm_timing_now());
+        return E_SUCCESS;
     }
-    if (sigaddset(&cur_set, SIGCHLD) == -1 || sigaddset(&cur_set, SIGUSR1) == -1)
+
+    char* buf = srv->_readybuf;
+    size_t len = srv->_readybuf_len;
+    ssize_t r = read(srv->ready_fd, buf + len, sizeof(srv->_readybuf) - 1 - len);
+    if (r == -1)
     {
-        log_err("sigaddset failed: %m");
-        return_code = E_PROGRAMMING;
-        goto cleanup;
+        if (errno == EINTR || errno == EAGAIN) return E_SUCCESS;
+        log_err("cannot read from -displayfd pipe: %m");
+        return E_OS_ERROR;
     }
-    if (sigprocmask(SIG_UNBLOCK, &cur_set, &orig_set) == -1)
+    if (r == 0)
     {
-        log_err("sigprocmask failed: %m");
-        return_code = E_PROGRAMMING;
-        goto cleanup;
+        // The server closed the pipe without telling us the display: it is
+        // most likely going away, and its pidfd will tell us when it does
+        log_verb("X server closed -displayfd without writing a display number");
+        close(srv->ready_fd);
+        srv->ready_fd = -1;
+        return E_SUCCESS;
     }
-    signal_mask_altered = true;
 
-    // Wait for SIGUSR1, for the server to die or for a timeout
-    struct timespec timeout = { .tv_sec = srv->conf_timeout, .tv_nsec = 0 };
-    while (!server_started)
+    len += r;
+    buf[len] = 0;
+    srv->_readybuf_len = len;
+    if (strchr(buf, '\n') == NULL)
     {
-        // Check if the server has died
-        int status;
-        pid_t res = waitpid(srv->pid, &status, WNOHANG);
-        if (res == -1)
+        if (len == sizeof(srv->_readybuf) - 1)
         {
-            if (errno == EINTR) continue;
-            log_err("waitpid on %s failed: %m", srv->argv[0]);
-            return_code = E_OS_ERROR;
+            log_err("X server wrote an overlong display number on -displayfd");
+            return E_X_SERVER_CONNECT;
+        }
+        return E_SUCCESS;
+    }
+
+    char* end;
+    long num = strtol(buf, &end, 10);
+    if (end == buf || *end != '\n' || num < 0 || num > 65535)
+    {
+        log_err("X server wrote an invalid display number on -displayfd");
+        return E_X_SERVER_CONNECT;
+    }
+    snprintf(srv->_namebuf, sizeof(srv->_namebuf), ":%d", (int)num);
+    srv->name = srv->_namebuf;
+    log_verb("X server is running on display %s", srv->name);
+
+    close(srv->ready_fd);
+    srv->ready_fd = -1;
+    srv->ready = true;
+    if (srv->report_timing)
+        nodm_timing_report(NODM_PHASE_X_READY, srv->start_time, nodm_timing_now());
+    return E_SUCCESS;
+}
+
+int nodm_xserver_reap(struct nodm_xserver* srv, int* status)
+{
+    while (waitpid(srv->pid, status, 0) == -1)
+    {
+        if (errno == EINTR) continue;
+        log_err("waitpid on X server %d failed: %m", (int)srv->pid);
+        return E_OS_ERROR;
+    }
+    nodm_xserver_report_exit(srv, *status);
+    srv->pid = -1;
+    if (srv->pidfd != -1)
+    {
+        close(srv->pidfd);
+        srv->pidfd = -1;
+    }
+    return E_SUCCESS;
+}
+
+int nodm_xserver_start(struct nodm_xserver* srv)
+{
+    // Function return code
+    int return_code = E_SUCCESS;
+    // signalfd used to receive SIGUSR1 if not using -displayfd
+    int sigfd = -1;
+
+    if (!srv->conf_use_displayfd)
+    {
+        // SIGUSR1 needs to be blocked before the server can send it. It is
+        // left blocked afterwards, since the server sends it again at every
+        // reset
+        sigset_t usr1;
+        if (sigemptyset(&usr1) == -1 || sigaddset(&usr1, SIGUSR1) == -1
+            || sigprocmask(SIG_BLOCK, &usr1, NULL) == -1)
+        {
+            log_err("signal operations error: %m");
+            return E_PROGRAMMING;
+        }
+        sigfd = signalfd(-1, &usr1, SFD_CLOEXEC);
+        if (sigfd == -1)
+        {
+            log_err("cannot create signalfd: %m");
+            return E_OS_ERROR;
+        }
+    }
+
+    return_code = nodm_xserver_spawn(srv);
+    if (return_code != E_SUCCESS) goto cleanup;
+
+    // Wait for the server to be ready, to die or for a timeout
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += srv->conf_timeout;
+    while (!srv->ready)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long remaining = (deadline.tv_sec - now.tv_sec) * 1000
+                       + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+        if (remaining <= 0)
+        {
+            log_err("X server did not respond after %u seconds", srv->conf_timeout);
+            return_code = E_X_SERVER_TIMEOUT;
             goto cleanup;
         }
-        if (res == srv->pid)
+
+        // A negative fd is ignored by poll
+        struct pollfd fds[2] = {
+            { .fd = srv->conf_use_displayfd ? srv->ready_fd : sigfd, .events = POLLIN },
+            { .fd = srv->pidfd, .events = POLLIN },
+        };
+        if (poll(fds, 2, remaining) == -1)
         {
-            nodm_xserver_report_exit(srv, status);
-            srv->pid = -1;
-            return_code = E_X_SERVER_DIED;
+            if (errno == EINTR) continue;
+            log_err("poll failed: %m");
+            return_code = E_OS_ERROR;
             goto cleanup;
         }
 
-        // Wait some time for something to happen
-        struct timespec rem;
-        if (nanosleep(&timeout, &rem) == -1)
+        if (fds[0].revents)
         {
-            if (errno == EINTR)
+            if (sigfd != -1)
             {
-                timeout = rem;
-                continue;
+                struct signalfd_siginfo si;
+                if (read(sigfd, &si, sizeof(si)) != sizeof(si))
+                    continue;
+                if ((pid_t)si.ssi_pid != srv->pid)
+                    continue;
             }
-            log_err("nanosleep failed: %m");
-            return_code = E_OS_ERROR;
-            goto cleanup;
-        } else {
-            log_err("X server did not respond after %u seconds", srv->conf_timeout);
-            return_code = E_X_SERVER_TIMEOUT;
+            return_code = nodm_xserver_handle_ready(srv);
+            if (return_code != E_SUCCESS) goto cleanup;
+            if (srv->ready) break;
+        }
+
+        if (fds[1].revents)
+        {
+            int status;
+            return_code = nodm_xserver_reap(srv, &status);
+            if (return_code != E_SUCCESS) goto cleanup;
+            return_code = E_X_SERVER_DIED;
             goto cleanup;
         }
     }
@@ -246,18 +396,13 @@ int nodm_xserver_start(struct nodm_xserver* srv)
     if (return_code != E_SUCCESS) goto cleanup;
 
 cleanup:
-    // Restore signal mask
-    if (signal_mask_altered)
-        if (sigprocmask(SIG_SETMASK, &orig_set, NULL) == -1)
-            log_err("sigprocmask failed: %m");
+    if (sigfd != -1)
+        close(sigfd);
 
     // Kill the X server if an error happened
     if (srv->pid > 0 && return_code != E_SUCCESS)
         nodm_xserver_stop(srv);
 
-    // Restore signal handlers
-    sigaction(SIGCHLD, NULL, &sa_sigchld_old);
-    sigaction(SIGUSR1, NULL, &sa_usr1_old);
     return return_code;
 }
 
@@ -265,8 +410,20 @@ int nodm_xserver_stop(struct nodm_xserver* srv)
 {
     nodm_xserver_disconnect(srv);
 
+    if (srv->ready_fd != -1)
+    {
+        close(srv->ready_fd);
+        srv->ready_fd = -1;
+    }
+
     int res = child_must_exit(srv->pid, "X server");
     srv->pid = -1;
+    if (srv->pidfd != -1)
+    {
+        close(srv->pidfd);
+        srv->pidfd = -1;
+    }
+    srv->ready = false;
 
     if (srv->windowpath != NULL)
     {
@@ -427,6 +584,7 @@ int nodm_xserver_read_window_path(struct nodm_xserver* srv)
 void nodm_xserver_dump_status(struct nodm_xserver* srv)
 {
     fprintf(stderr, "xserver start timeout: %d\n", srv->conf_timeout);
+    fprintf(stderr, "xserver uses -displayfd: %s\n", srv->conf_use_displayfd ? "yes" : "no");
     fprintf(stderr, "xserver command line:");
     for (const char** s = srv->argv; *s; ++s)
         fprintf(stderr, " %s", *s);
@@ -21,6 +21,9 @@
 #ifndef NODM_SERVER_H
 #define NODM_SERVER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <X11/Xlib.h>
 
@@ -30,6 +33,13 @@ struct nodm_xserver
     /// Timeout (in seconds) to use waiting for X to start
     int conf_timeout;
 
+    /**
+     * If true, pass -displayfd to the X server, and use it both to know when
+     * the server is ready and to read the display name that it chose.
+     * Otherwise, wait for the SIGUSR1 readiness notification.
+     */
+    bool conf_use_displayfd;
+
     /// X server command line
     const char **argv;
     /// X display name
@@ -38,10 +48,29 @@ struct nodm_xserver
     char *windowpath;
     /// X server pid
     pid_t pid;
+    /// pidfd for the X server, readable when it exits (-1 if not running)
+    int pidfd;
+    /**
+     * Read end of the -displayfd pipe while waiting for the server to start
+     * (-1 if not in use)
+     */
+    int ready_fd;
+    /// True once the server is ready to accept connections
+    bool ready;
+    /// Time the X server was forked (monotonic microseconds)
+    uint64_t start_time;
+    /// If true, report startup phase timings for this server
+    bool report_timing;
     /// xlib Display connected to the server
     Display *dpy;
     /// Original signal mask at program startup
     sigset_t orig_signal_mask;
+
+    /// Storage for the display name read via -displayfd
+    char _namebuf[16];
+    /// Partial data read from the -displayfd pipe
+    char _readybuf[16];
+    size_t _readybuf_len;
 };
 
 /**
@@ -52,14 +81,57 @@ void nodm_xserver_init(struct nodm_xserver* srv);
 /**
  * Start the X server and wait until it is ready to accept connections.
  *
+ * This is a blocking version of nodm_xserver_spawn and
+ * nodm_xserver_handle_ready, followed by nodm_xserver_connect. When not using
+ * -displayfd, it leaves SIGUSR1 blocked, since the server sends it again at
+ * every reset.
+ *
  * @param srv
  *   The struct nodm_xserver with X server information. argv and name are expected to
- *   be filled, pid is filled.
+ *   be filled, pid is filled. If conf_use_displayfd is true, name can be NULL
+ *   and is set to the display chosen by the server.
  * @return
  *   Exit status as described by the E_* constants
  */
 int nodm_xserver_start(struct nodm_xserver* srv);
 
+/**
+ * Fork and exec the X server, without waiting for it to be ready.
+ *
+ * Sets srv->pid and srv->pidfd, and if conf_use_displayfd is set,
+ * srv->ready_fd. Without -displayfd, the server sends SIGUSR1 to the calling
+ * process when it is ready: the caller needs to have SIGUSR1 blocked or
+ * handled before calling this function.
+ *
+ * @return
+ *   Exit status as described by the E_* constants
+ */
+int nodm_xserver_spawn(struct nodm_xserver* srv);
+
+/**
+ * Process a readiness notification from the X server.
+ *
+ * Call it when srv->ready_fd is readable, or when SIGUSR1 is received from
+ * srv->pid if not using -displayfd. It sets srv->ready once the server is
+ * ready to accept connections, and closes srv->ready_fd when it is no longer
+ * needed.
+ *
+ * @return
+ *   Exit status as described by the E_* constants
+ */
+int nodm_xserver_handle_ready(struct nodm_xserver* srv);
+
+/**
+ * Reap the X server after its pidfd became readable.
+ *
+ * Reports its exit, stores the wait status in \a status and resets srv->pid
+ * and srv->pidfd.
+ *
+ * @return
+ *   Exit status as described by the E_* constants
+ */
+int nodm_xserver_reap(struct nodm_xserver* srv, int* status);
+
 /// Stop the X server
 int nodm_xserver_stop(struct nodm_xserver* srv);
 
@@ -69,6 +69,7 @@
 #include "xserver.h"
 #include "common.h"
 #include "log.h"
+#include "timing.h"
 #include <security/pam_appl.h>
 #include <security/pam_misc.h>
 #include <sys/types.h>
@@ -185,6 +186,7 @@ static int setup_pam(struct nodm_xsession_child* s)
 
     char *cp;
     const char *tty = 0;    // Name of tty SU is run from
+    uint64_t pam_start_time = nodm_timing_now();
 
     /* We only run if we are root */
     if (getuid() != 0)
@@ -285,6 +287,7 @@ static int setup_pam(struct nodm_xsession_child* s)
         return E_OS_ERROR;
     }
 
+    nodm_timing_report(NODM_PHASE_PAM, pam_start_time, nodm_timing_now());
     return E_SUCCESS;
 }
 
@@ -315,6 +318,7 @@ int nodm_xsession_child_common_env(struct nodm_xsession_child* s)
     setenv("DISPLAY", s->srv->name, 1);
 
     // Read the WINDOWPATH value from the X server
+    uint64_t windowpath_start = nodm_timing_now();
     return_code = nodm_xserver_connect(s->srv);
     if (return_code != E_SUCCESS) goto cleanup;
     return_code = nodm_xserver_read_window_path(s->srv);
@@ -323,6 +327,7 @@ int nodm_xsession_child_common_env(struct nodm_xsession_child* s)
     if (return_code != E_SUCCESS) goto cleanup;
 
     setenv("WINDOWPATH", s->srv->windowpath, 1);
+    nodm_timing_report(NODM_PHASE_WINDOWPATH, windowpath_start, nodm_timing_now());
 
 
     // Clear the NODM_* environment variables
@@ -366,6 +371,7 @@ int nodm_xsession_child(struct nodm_xsession_child* s)
      * memory since we will either call exec or exit.
     pam_end (pamh, PAM_SUCCESS | PAM_DATA_SILENT);
      */
+    nodm_timing_report(NODM_PHASE_SESSION_EXEC, s->start_time, nodm_timing_now());
     (void)execv(s->argv[0], (char **)s->argv);
     exit(errno == ENOENT ? E_CMD_NOTFOUND : E_CMD_NOEXEC);
 }
@@ -427,6 +433,7 @@ int nodm_xsession_child_pam(struct nodm_xsession_child* s)
          * memory since we will either call exec or exit.
         pam_end (pamh, PAM_SUCCESS | PAM_DATA_SILENT);
          */
+        nodm_timing_report(NODM_PHASE_SESSION_EXEC, s->start_time, nodm_timing_now());
         (void) execv(s->argv[0], (char **)s->argv);
         exit (errno == ENOENT ? E_CMD_NOTFOUND : E_CMD_NOEXEC);
     } else if (child == -1) {
@@ -22,6 +22,7 @@
 #define NODM_XSESSION_CHILD_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <pwd.h>
 #include <security/pam_appl.h>
 
@@ -47,6 +48,9 @@ struct nodm_xsession_child
     /// Command line to run
     const char** argv;
 
+    /// Time the session process was forked (monotonic microseconds)
+    uint64_t start_time;
+
     /// Child exit status
     int exit_status;
 };
@@ -23,6 +23,7 @@
 #include "xserver.h"
 #include "log.h"
 #include "common.h"
+#include "timing.h"
 #include <errno.h>
 #include <signal.h>
 #include <pwd.h>
@@ -51,6 +52,7 @@ int nodm_xsession_init(struct nodm_xsession* s)
         log_warn("session command has been truncated");
 
     s->pid = -1;
+    s->pidfd = -1;
 
     return E_SUCCESS;
 }
@@ -62,6 +64,7 @@ int nodm_xsession_start(struct nodm_xsession* s, struct nodm_xserver* srv)
     child.conf_cleanup_xse = s->conf_cleanup_xse;
 
     // Validate the user using the normal system user database
+    uint64_t lookup_start = nodm_timing_now();
     struct passwd *pw = 0;
     if (s->conf_run_as[0] == 0)
         pw = getpwuid(getuid());
@@ -73,6 +76,7 @@ int nodm_xsession_start(struct nodm_xsession* s, struct nodm_xserver* srv)
         return E_OS_ERROR;
     }
     child.pwent = *pw;
+    nodm_timing_report(NODM_PHASE_GETPWNAM, lookup_start, nodm_timing_now());
 
     // Create the argument list
     const char* args[5];
@@ -116,6 +120,8 @@ int nodm_xsession_start(struct nodm_xsession* s, struct nodm_xserver* srv)
     s->pid = fork();
     if (s->pid == 0)
     {
+        child.start_time = nodm_timing_now();
+
         // Restore the original signal mask
         if (sigprocmask(SIG_SETMASK, &s->orig_signal_mask, NULL) == -1)
             log_err("sigprocmask failed: %m");
@@ -134,6 +140,32 @@ int nodm_xsession_start(struct nodm_xsession* s, struct nodm_xserver* srv)
         return E_OS_ERROR;
     }
 
+    s->pidfd = nodm_pidfd_open(s->pid);
+    if (s->pidfd == -1)
+    {
+        log_err("cannot open pidfd for X session: %m");
+        nodm_xsession_stop(s);
+        return E_OS_ERROR;
+    }
+
+    return E_SUCCESS;
+}
+
+int nodm_xsession_reap(struct nodm_xsession* s, int* status)
+{
+    while (waitpid(s->pid, status, 0) == -1)
+    {
+        if (errno == EINTR) continue;
+        log_err("waitpid on X session %d failed: %m", (int)s->pid);
+        return E_OS_ERROR;
+    }
+    nodm_xsession_report_exit(s, *status);
+    s->pid = -1;
+    if (s->pidfd != -1)
+    {
+        close(s->pidfd);
+        s->pidfd = -1;
+    }
     return E_SUCCESS;
 }
 
@@ -141,6 +173,11 @@ int nodm_xsession_stop(struct nodm_xsession* s)
 {
     int res = child_must_exit(s->pid, "X session");
     s->pid = -1;
+    if (s->pidfd != -1)
+    {
+        close(s->pidfd);
+        s->pidfd = -1;
+    }
     return res;
 }
 
@@ -49,6 +49,9 @@ struct nodm_xsession
     /// X session pid
     pid_t pid;
 
+    /// pidfd for the X session, readable when it exits (-1 if not running)
+    int pidfd;
+
     /// If non-NULL, use as child process main body (used for tests)
     int (*child_body)(struct nodm_xsession_child* s);
 
@@ -62,6 +65,14 @@ int nodm_xsession_init(struct nodm_xsession* s);
 /// Start the X session
 int nodm_xsession_start(struct nodm_xsession* s, struct nodm_xserver* srv);
 
+/**
+ * Reap the X session after its pidfd became readable.
+ *
+ * Reports its exit, stores the wait status in \a status and resets s->pid
+ * and s->pidfd.
+ */
+int nodm_xsession_reap(struct nodm_xsession* s, int* status);
+
 /// Stop the X session
 int nodm_xsession_stop(struct nodm_xsession* s);
 